@@ -3,17 +3,23 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #if __GNUC__
 #  define INI_NONULL __attribute__((nonnull))
 #  define INI_NONULLV(...) __attribute__((nonnull(__VA_ARGS__)))
+#  define INI_PURE __attribute__((pure))
+#  define INI_CONST __attribute__((const))
 #else
 #  define INI_NONULL
 #  define INI_NONULLV
+#  define INI_PURE
+#  define INI_CONST
 #endif
 
 struct ini;
 struct ini_data;
+struct ini_cache;
 
 INI_NONULL typedef void (*ini_throw_cb)(struct ini *ini, size_t line_num, size_t position, const char *line, const char *message);
 
@@ -21,6 +27,7 @@ struct ini {
    struct ini_data *data;
    ini_throw_cb throw; // set to ini_throw_cb function to catch parsing errors
    char delim;
+   struct ini_cache *cache; // set to ini_cache() to share parsed include files, NULL uses cache of this struct ini cleared by ini_flush()
 };
 
 struct ini_options {
@@ -28,6 +35,16 @@ struct ini_options {
    bool quoted_strings;
    bool empty_values;
    bool empty_keys;
+   bool includes; // "@include path" and "!include path" lines, relative paths are relative to including file
+   bool interpolation; // expand ${section.key}, ${key} (same section) and ${ENV:NAME} in values, $$ is literal $
+
+   // limits for untrusted input, parsing stops at first exceeded limit, 0 for no limit
+   size_t max_bytes; // total input size, including included files and expanded values
+   size_t max_keys;
+   size_t max_value_length;
+   size_t max_line_length;
+   size_t max_sections;
+   uint32_t max_milliseconds;
 };
 
 struct ini_value {
@@ -35,6 +52,29 @@ struct ini_value {
    size_t size;
 };
 
+// precomputed lookup key, see ini_key()
+struct ini_key {
+   const char *path;
+   size_t size;
+   uint32_t hash;
+};
+
+// read-only table generated by ini2c, see ini_static()
+// entries refer to strings by offset, so generated arrays don't need relocations
+struct ini_static_entry {
+   size_t path, data; // offsets to strings, data is NULL when size is 0
+   size_t path_size, size;
+   uint32_t hash;
+};
+
+struct ini_static {
+   const char *strings; // null terminated paths and values of all entries
+   const struct ini_static_entry *entries; // keys with same hash are next to each other
+   const uint32_t *seeds; // perfect hash displacement for each bucket
+   const uint32_t *slots; // first entry for each distinct hash
+   size_t count, buckets, size;
+};
+
 struct ini_iterator {
    const char *path;
 };
@@ -45,12 +85,24 @@ struct ini_iterator {
 #define ini_for_each(ini, v) \
    for (struct ini_iterator _I = { NULL }; ini_iter(ini, &_I, v);)
 
+// size is hint for expected number of keys, 0 is fine as table grows automatically
 INI_NONULLV(1) bool ini(struct ini *ini, char delim, size_t size, ini_throw_cb cb);
+INI_NONULL bool ini_static(struct ini *ini, const struct ini_static *table); // parsing into static ini fails
 void ini_release(struct ini *ini);
+
+// include files parsed once are reused by every struct ini sharing the cache, it's not thread safe
+// and is only used while parsing, so it can be released whenever nothing is being parsed with it
+struct ini_cache* ini_cache(void);
+void ini_cache_release(struct ini_cache *cache);
 INI_NONULL void ini_flush(struct ini *ini);
 INI_NONULLV(1,2) bool ini_parse_from_memory(struct ini *ini, const char *buffer, size_t size, const struct ini_options *options);
 INI_NONULLV(1,2) bool ini_parse(struct ini *ini, const char *path, const struct ini_options *options);
 INI_NONULLV(1,2) bool ini_get(struct ini *ini, const char *path, struct ini_value *out_value);
+INI_NONULL void ini_key(struct ini_key *key, const char *path);
+
+// batched lookups, missing keys get NULL value, returns number of keys found
+INI_NONULL size_t ini_get_keys(struct ini *ini, const struct ini_key keys[], size_t n, struct ini_value out_values[]);
+INI_NONULL size_t ini_get_many(struct ini *ini, const char *const paths[], size_t n, struct ini_value out_values[]);
 INI_NONULL bool ini_iter(struct ini *ini, struct ini_iterator *iterator, struct ini_value *out_value);
 INI_NONULL void ini_print(struct ini *ini);
 
@@ -0,0 +1,39 @@
+#ifndef __inihck_hash_h__
+#define __inihck_hash_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// shared by the library and ini2c, generated tables depend on these staying the same
+
+static inline uint32_t
+hash_fmix(uint32_t hash)
+{
+   // murmur3 finalizer
+   hash ^= hash >> 16;
+   hash *= 0x85ebca6b;
+   hash ^= hash >> 13;
+   hash *= 0xc2b2ae35;
+   hash ^= hash >> 16;
+   return hash;
+}
+
+static inline uint32_t
+hash_str(const char *str, size_t len)
+{
+   // FNV-1a with finalizer, so the low bits are usable as slot index
+   uint32_t hash = 2166136261u;
+   for (size_t i = 0; i < len; ++i)
+      hash = (hash ^ (uint8_t)str[i]) * 16777619u;
+
+   return hash_fmix(hash);
+}
+
+static inline uint32_t
+hash_seed(uint32_t hash, uint32_t seed)
+{
+   // rehash of already hashed key, used for displacement in perfect hash tables
+   return hash_fmix(hash ^ (seed * 0x9e3779b9u));
+}
+
+#endif /* __inihck_hash_h__ */
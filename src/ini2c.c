@@ -0,0 +1,377 @@
+#include <inihck/inihck.h>
+#include "hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+// Turns ini file into C source file with const struct ini_static, so configs known at build time
+// can be used through ini_static() without parsing anything at runtime.
+
+struct key {
+   const char *path, *data;
+   size_t path_size, size;
+   uint32_t hash;
+};
+
+// keys with the same 32bit hash, perfect hash maps each group to its own slot
+struct group {
+   size_t first, count; // range in keys sorted by hash
+   uint32_t hash, slot;
+};
+
+static void
+throw(struct ini *ini, size_t line_num, size_t position, const char *line, const char *message)
+{
+   (void)ini;
+   fprintf(stderr, "[%zu, %zu]: %s\n", line_num, position, message);
+   fprintf(stderr, "%s\n%*c\n", line, (int)position, '^');
+}
+
+static void
+usage(const char *name)
+{
+   fprintf(stderr, "usage: %s [-e] [-q] [-v] [-k] [-i] [-I] [-d delim] input.ini name [output.c]\n", name);
+   fprintf(stderr, "  -e  escaping\n"
+                   "  -q  quoted strings\n"
+                   "  -v  empty values\n"
+                   "  -k  empty keys\n"
+                   "  -i  includes\n"
+                   "  -I  interpolation\n"
+                   "  -d  path delimiter, '.' by default\n");
+}
+
+static INI_PURE bool
+is_identifier(const char *str)
+{
+   assert(str);
+
+   // ctype functions take unsigned char values, plain char may be negative for non-ASCII names
+   if (!isalpha((unsigned char)*str) && *str != '_')
+      return false;
+
+   for (; *str; ++str)
+      if (!isalnum((unsigned char)*str) && *str != '_')
+         return false;
+
+   return true;
+}
+
+static int
+compare_hash(const void *a, const void *b)
+{
+   const struct key *ka = a, *kb = b;
+   return (ka->hash > kb->hash) - (ka->hash < kb->hash);
+}
+
+static const uint32_t *sort_counts;
+
+static int
+compare_bucket(const void *a, const void *b)
+{
+   // biggest buckets first, they are hardest to place
+   const uint32_t ca = sort_counts[*(const uint32_t*)a], cb = sort_counts[*(const uint32_t*)b];
+   return (ca < cb) - (ca > cb);
+}
+
+static bool
+build(struct group *groups, size_t count, uint32_t *seeds, size_t buckets)
+{
+   assert(groups && seeds && buckets > 0);
+
+   bool ret = false;
+   uint32_t *counts = calloc(buckets, sizeof(uint32_t)), *order = calloc(buckets, sizeof(uint32_t));
+   uint32_t *members = calloc(count + 1, sizeof(uint32_t)), *starts = calloc(buckets + 1, sizeof(uint32_t));
+   uint32_t *slots = calloc(count + 1, sizeof(uint32_t));
+   bool *taken = calloc(count + 1, sizeof(bool));
+
+   if (!counts || !order || !members || !starts || !slots || !taken)
+      goto out;
+
+   for (size_t g = 0; g < count; ++g)
+      ++counts[groups[g].hash % buckets];
+
+   for (size_t b = 0; b < buckets; ++b) {
+      starts[b + 1] = starts[b] + counts[b];
+      order[b] = b;
+   }
+
+   {
+      uint32_t *fill = calloc(buckets, sizeof(uint32_t));
+      if (!fill)
+         goto out;
+
+      for (size_t g = 0; g < count; ++g) {
+         const size_t b = groups[g].hash % buckets;
+         members[starts[b] + fill[b]++] = g;
+      }
+
+      free(fill);
+   }
+
+   sort_counts = counts;
+   qsort(order, buckets, sizeof(uint32_t), compare_bucket);
+
+   for (size_t i = 0; i < buckets && counts[order[i]] > 0; ++i) {
+      const uint32_t b = order[i];
+      const uint32_t *member = members + starts[b];
+
+      uint32_t seed;
+      for (seed = 0; seed < (1u << 24); ++seed) {
+         uint32_t placed = 0;
+         for (; placed < counts[b]; ++placed) {
+            const uint32_t slot = hash_seed(groups[member[placed]].hash, seed) % count;
+            if (taken[slot])
+               break;
+
+            taken[slot] = true;
+            slots[placed] = slot;
+         }
+
+         if (placed == counts[b])
+            break;
+
+         // undo partial placement and try next seed
+         for (uint32_t k = 0; k < placed; ++k)
+            taken[slots[k]] = false;
+      }
+
+      if (seed >= (1u << 24)) {
+         fprintf(stderr, "Could not find perfect hash for %zu keys\n", count);
+         goto out;
+      }
+
+      seeds[b] = seed;
+      for (uint32_t k = 0; k < counts[b]; ++k)
+         groups[member[k]].slot = slots[k];
+   }
+
+   ret = true;
+
+out:
+   free(counts);
+   free(order);
+   free(members);
+   free(starts);
+   free(slots);
+   free(taken);
+   return ret;
+}
+
+static void
+write_string(FILE *f, const char *str, size_t len)
+{
+   assert(f && (str || !len));
+
+   fputc('"', f);
+   for (size_t i = 0; i < len; ++i) {
+      const unsigned char chr = str[i];
+      if (chr == '"' || chr == '\\' || chr == '?') {
+         // ? is escaped so trigraphs can't happen
+         fprintf(f, "\\%c", chr);
+      } else if (chr < 0x20 || chr >= 0x7f) {
+         // always 3 digits, so following digits are not part of the escape
+         fprintf(f, "\\%03o", chr);
+      } else {
+         fputc(chr, f);
+      }
+   }
+   fputs("\\000\"", f);
+}
+
+static INI_PURE size_t
+value_length(const struct key *key)
+{
+   assert(key);
+   // values are null terminated and their size includes it, the string blob adds terminator anyway
+   return (key->size > 0 && !key->data[key->size - 1] ? key->size - 1 : key->size);
+}
+
+static bool
+write_source(FILE *f, const char *input, const char *name, const struct key *keys, const struct group *groups, size_t count, const uint32_t *seeds, size_t buckets)
+{
+   assert(f && input && name && keys && (groups || !count) && seeds);
+
+   // only basename, so output doesn't depend on where the build happens
+   const char *base = strrchr(input, '/');
+   fprintf(f, "/* generated by ini2c from %s, do not edit */\n", (base ? base + 1 : input));
+   fprintf(f, "#include <inihck/inihck.h>\n\n");
+
+   size_t entries = 0;
+   for (size_t g = 0; g < count; ++g)
+      entries += groups[g].count;
+
+   // entries are laid out in slot order, so slot stores index of the first key of its group
+   size_t *at_slot = calloc(count + 1, sizeof(size_t));
+   if (!at_slot)
+      return false;
+
+   for (size_t g = 0; g < count; ++g)
+      at_slot[groups[g].slot] = g;
+
+   // strings are in one blob and entries refer to it by offset, so nothing but the final struct needs relocations
+   fprintf(f, "static const char %s_strings[] =", name);
+   for (size_t s = 0; s < count; ++s) {
+      const struct group *group = &groups[at_slot[s]];
+      for (size_t i = group->first; i < group->first + group->count; ++i) {
+         fputs("\n   ", f);
+         write_string(f, keys[i].path, keys[i].path_size);
+
+         if (keys[i].size > 0) {
+            fputs("\n   ", f);
+            write_string(f, keys[i].data, value_length(&keys[i]));
+         }
+      }
+   }
+   fputs((entries > 0 ? ";\n\n" : " \"\";\n\n"), f);
+
+   if (entries > 0) {
+      fprintf(f, "static const struct ini_static_entry %s_entries[] = {\n", name);
+      for (size_t s = 0, offset = 0; s < count; ++s) {
+         const struct group *group = &groups[at_slot[s]];
+         for (size_t i = group->first; i < group->first + group->count; ++i) {
+            const size_t path = offset, data = (keys[i].size > 0 ? path + keys[i].path_size + 1 : 0);
+            offset += keys[i].path_size + 1 + (keys[i].size > 0 ? value_length(&keys[i]) + 1 : 0);
+            fprintf(f, "   { %zu, %zu, %zu, %zu, 0x%08xu },\n", path, data, keys[i].path_size, keys[i].size, (unsigned int)keys[i].hash);
+         }
+      }
+      fputs("};\n\n", f);
+
+      fprintf(f, "static const uint32_t %s_slots[] = {", name);
+      for (size_t s = 0, index = 0; s < count; index += groups[at_slot[s]].count, ++s)
+         fprintf(f, "%s%zu,", (s % 8 ? " " : "\n   "), index);
+      fputs("\n};\n\n", f);
+   }
+
+   fprintf(f, "static const uint32_t %s_seeds[] = {", name);
+   for (size_t b = 0; b < buckets; ++b)
+      fprintf(f, "%s%u,", (b % 8 ? " " : "\n   "), (unsigned int)seeds[b]);
+   fputs("\n};\n\n", f);
+
+   fprintf(f, "extern const struct ini_static %s;\n", name);
+   fprintf(f, "const struct ini_static %s = {\n", name);
+   if (entries > 0)
+      fprintf(f, "   %s_strings, %s_entries, %s_seeds, %s_slots, %zu, %zu, %zu\n", name, name, name, name, entries, buckets, count);
+   else
+      fprintf(f, "   %s_strings, NULL, %s_seeds, NULL, 0, %zu, 0\n", name, name, buckets);
+   fputs("};\n", f);
+
+   free(at_slot);
+   return !ferror(f);
+}
+
+int
+main(int argc, char *argv[])
+{
+   char delim = '.';
+   struct ini_options options = {0};
+   const char *args[3] = { NULL, NULL, NULL };
+
+   for (int i = 1, a = 0; i < argc; ++i) {
+      if (argv[i][0] == '-' && argv[i][1] && !argv[i][2]) {
+         switch (argv[i][1]) {
+            case 'e': options.escaping = true; continue;
+            case 'q': options.quoted_strings = true; continue;
+            case 'v': options.empty_values = true; continue;
+            case 'k': options.empty_keys = true; continue;
+            case 'i': options.includes = true; continue;
+            case 'I': options.interpolation = true; continue;
+            case 'd':
+               if (i + 1 < argc && argv[i + 1][0] && !argv[i + 1][1]) {
+                  delim = argv[++i][0];
+                  continue;
+               }
+               break;
+         }
+
+         usage(argv[0]);
+         return EXIT_FAILURE;
+      }
+
+      if (a >= 3) {
+         usage(argv[0]);
+         return EXIT_FAILURE;
+      }
+
+      args[a++] = argv[i];
+   }
+
+   if (!args[0] || !args[1]) {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   if (!is_identifier(args[1])) {
+      fprintf(stderr, "'%s' is not valid C identifier\n", args[1]);
+      return EXIT_FAILURE;
+   }
+
+   struct ini inif;
+   if (!ini(&inif, delim, 0, throw))
+      return EXIT_FAILURE;
+
+   int ret = EXIT_FAILURE;
+   struct key *keys = NULL;
+   struct group *groups = NULL;
+   uint32_t *seeds = NULL;
+
+   if (!ini_parse(&inif, args[0], &options)) {
+      fprintf(stderr, "Could not parse '%s'\n", args[0]);
+      goto out;
+   }
+
+   size_t count = 0;
+   struct ini_value v;
+   ini_for_each(&inif, &v) ++count;
+
+   if (!(keys = calloc(count + 1, sizeof(struct key))) || !(groups = calloc(count + 1, sizeof(struct group))))
+      goto out;
+
+   {
+      size_t i = 0;
+      ini_for_each(&inif, &v) {
+         keys[i] = (struct key){ _I.path, v.data, strlen(_I.path), v.size, 0 };
+         keys[i].hash = hash_str(keys[i].path, keys[i].path_size);
+         ++i;
+      }
+   }
+
+   qsort(keys, count, sizeof(struct key), compare_hash);
+
+   size_t ngroups = 0;
+   for (size_t i = 0; i < count; ++i) {
+      if (ngroups > 0 && groups[ngroups - 1].hash == keys[i].hash) {
+         ++groups[ngroups - 1].count;
+      } else {
+         groups[ngroups++] = (struct group){ i, 1, keys[i].hash, 0 };
+      }
+   }
+
+   // about 2 groups for each bucket keeps the seed search short
+   const size_t buckets = ngroups / 2 + 1;
+   if (!(seeds = calloc(buckets, sizeof(uint32_t))) || !build(groups, ngroups, seeds, buckets))
+      goto out;
+
+   FILE *f = stdout;
+   if (args[2] && !(f = fopen(args[2], "wb"))) {
+      fprintf(stderr, "Could not open '%s' for writing\n", args[2]);
+      goto out;
+   }
+
+   const bool written = write_source(f, args[0], args[1], keys, groups, ngroups, seeds, buckets);
+
+   if ((f != stdout && fclose(f) != 0) || !written) {
+      fprintf(stderr, "Could not write '%s'\n", (args[2] ? args[2] : "stdout"));
+      goto out;
+   }
+
+   ret = EXIT_SUCCESS;
+
+out:
+   free(seeds);
+   free(groups);
+   free(keys);
+   ini_release(&inif);
+   return ret;
+}
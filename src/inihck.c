@@ -1,5 +1,5 @@
 #include <inihck/inihck.h>
-#include <chck/lut/lut.h>
+#include "hash.h"
 #include <chck/pool/pool.h>
 #include <chck/string/string.h>
 #include <chck/unicode/unicode.h>
@@ -8,55 +8,163 @@
 #include <stdarg.h>
 #include <ctype.h>
 #include <limits.h>
+#include <time.h>
 #include <assert.h>
 
+#if __GNUC__
+#  define prefetch(x) __builtin_prefetch(x)
+#else
+#  define prefetch(x) (void)(x)
+#endif
+
+struct entry {
+   struct chck_string path;
+   struct chck_string value;
+};
+
+struct slot {
+   uint32_t hash;
+   uint32_t index; // index to entries + 1, 0 for empty slot
+};
+
+// entries are allocated in chunks, so growing never moves or copies existing entries
+#define ENTRIES_PER_CHUNK 512
+
+struct table {
+   struct entry **chunks; // entries in insertion order
+   struct slot *slots; // open addressing with linear probing, size is power of two
+   struct slot *old; // slots being migrated after grow, lookups fall back to these
+   size_t count, allocated, size;
+   size_t old_size, migrated;
+};
+
+// parsed include file, cached by content, options and delimiter
+struct fragment {
+   struct ini_options options;
+   struct chck_iter_pool records; // struct record
+   char *content;
+   size_t size, sections; // sections are charged against limits every time fragment is grafted
+   uint32_t hash;
+   char delim; // keys containing delimiter are rejected, so it affects parsing too
+};
+
+// parsed include files, owned by struct ini or shared between several through ini_cache()
+struct ini_cache {
+   struct chck_iter_pool fragments; // struct fragment*, grafting may add fragments so they can't move
+   struct slot *slots; // fragments by content hash, size and options are compared on match
+   size_t size;
+};
+
+// key or nested include inside fragment
+struct record {
+   struct chck_string section; // empty if key goes under section of including file
+   struct chck_string key; // path to include for nested includes
+   struct chck_string value;
+   size_t line, line_start, cursor; // source position for errors
+   bool include;
+};
+
+// stack of files being included, for cycle detection
+struct include {
+   const char *path; // canonical, so different spellings of same file are caught
+   const struct include *parent;
+};
+
+// value waiting for interpolation, with copy of source position for errors
+struct pending {
+   size_t entry; // index to table entries
+   size_t line, position;
+   char *file; // set if value came from included file
+   char text[128];
+   enum {
+      PENDING,
+      RESOLVING,
+      RESOLVED,
+      FAILED, // error was reported, values referencing this fail too
+   } status;
+};
+
+// explicit stack of pending indices, so long reference chains can't overflow the call stack
+struct work {
+   size_t *items;
+   size_t count, allocated;
+};
+
 struct ini_data {
-   struct chck_hash_table table;
-   struct chck_hash_table_iterator iterator;
+   const struct ini_static *rodata; // read-only table instead of parsed one
+   struct table table;
+   struct chck_iter_pool pending; // struct pending, sorted by entry
+   struct ini_cache cache; // used when struct ini has no shared cache
+   size_t iterator;
+};
+
+// usage counted against limits of ini_options, shared by included files
+struct limits {
+   uint64_t deadline; // milliseconds, 0 for none
+   size_t bytes, keys, sections;
+   size_t includes; // total, bounded even without limits as includes can fan out exponentially
+   uint32_t steps; // since last deadline check
+   bool exceeded; // stop parsing
 };
 
 struct state {
    struct ini_options options;
+   struct limits *limits;
    struct chck_string key; // current key
    struct chck_string section; // current section
    const char *cursor; // current char
    const char *line_start; // where line started
    const char *buffer;
+   const char *file; // path of file being parsed, NULL if parsing from memory
+   const struct include *includes; // non NULL when parsing included file
+   struct fragment *fragment; // collect records here instead of table
    size_t line, size;
    uint16_t utf16_hi;
 };
 
 static void
-throw_message(struct ini *ini, const struct state *state, const char *message)
+copy_line(const struct state *state, char *line, size_t size)
 {
-   assert(ini && state && message);
-
-   if (!ini->throw)
-      return;
-
-   char line[128];
+   assert(state && line && size > 0);
    const size_t avail = state->size - (state->line_start - state->buffer);
-   const size_t len = (avail >= sizeof(line) ? sizeof(line) : avail);
+   const size_t len = (avail >= size ? size - 1 : avail);
    strncpy(line, state->line_start, len);
    line[len] = 0;
+   line[strcspn(line, "\n\r\v\f")] = 0;
+}
 
-   const size_t nl = strcspn(line, "\n\r\v\f");
-   const size_t end = (nl < sizeof(line) ? nl : sizeof(line));
-   line[end] = 0;
+static void
+throw_at(struct ini *ini, const char *file, size_t line_num, size_t position, const char *line, const char *fmt, va_list args)
+{
+   assert(ini && line && fmt);
+
+   // errors in included files are prefixed with the file name
+   char message[256];
+   size_t len = 0;
+   if (file) {
+      const int ret = snprintf(message, sizeof(message), "%s: ", file);
+      len = (ret < 0 ? 0 : ((size_t)ret >= sizeof(message) ? sizeof(message) - 1 : (size_t)ret));
+   }
 
-   ini->throw(ini, state->line, (size_t)(state->cursor - state->line_start + 1), line, message);
+   vsnprintf(message + len, sizeof(message) - len, fmt, args);
+   ini->throw(ini, line_num, position, line, message);
 }
 
 static void
 throw(struct ini *ini, const struct state *state, const char *fmt, ...)
 {
    assert(ini && state && fmt);
-   char message[128];
+
+   if (!ini->throw)
+      return;
+
+   char line[128];
+   copy_line(state, line, sizeof(line));
+
    va_list args;
    va_start(args, fmt);
-   vsnprintf(message, sizeof(message) - 1, fmt, args);
+   throw_at(ini, (state->includes ? state->file : NULL), state->line, (size_t)(state->cursor - state->line_start + 1), line, fmt, args);
    va_end(args);
-   throw_message(ini, state, message);
 }
 
 static bool
@@ -78,6 +186,87 @@ state_end(const struct state *state)
    return ((size_t)(state->cursor - state->buffer) >= state->size);
 }
 
+static uint64_t
+now_ms(void)
+{
+#if defined(_WIN32)
+   return (uint64_t)clock() * 1000 / CLOCKS_PER_SEC;
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+#endif
+}
+
+static bool
+past_deadline_now(struct ini *ini, const struct state *state)
+{
+   assert(ini && state && state->limits);
+
+   struct limits *limits = state->limits;
+   if (!limits->deadline || limits->exceeded || now_ms() <= limits->deadline)
+      return limits->exceeded;
+
+   throw(ini, state, "Parsing exceeds time limit of %u ms", state->options.max_milliseconds);
+   return (limits->exceeded = true);
+}
+
+static bool
+sample_deadline(struct ini *ini, const struct state *state, size_t *bytes)
+{
+   assert(bytes);
+   // for loops over single long line, clock is read every 4096 bytes
+   return (!(++*bytes & 4095) && past_deadline_now(ini, state));
+}
+
+static bool
+past_deadline(struct ini *ini, const struct state *state)
+{
+   assert(ini && state && state->limits);
+
+   // reading clock is not free, check every 64 steps
+   if (++state->limits->steps & 63)
+      return state->limits->exceeded;
+
+   return past_deadline_now(ini, state);
+}
+
+static bool
+check_lines(struct ini *ini, const struct state *state)
+{
+   assert(ini && state && state->limits);
+
+   const size_t max = state->options.max_line_length;
+   if (!max)
+      return true;
+
+   size_t line = 1, bytes = 0;
+   const char *start = state->buffer, *end = state->buffer + state->size;
+   for (const char *c = state->buffer; c <= end; ++c) {
+      if (sample_deadline(ini, state, &bytes))
+         return false;
+
+      if (c < end && !is_eol(*c))
+         continue;
+
+      if ((size_t)(c - start) > max) {
+         struct state at = *state;
+         at.line = line;
+         at.line_start = start;
+         at.cursor = start + max;
+         throw(ini, &at, "Line exceeds limit of %zu bytes", max);
+         state->limits->exceeded = true;
+         return false;
+      }
+
+      c += (c + 1 < end && *c == '\r' && *(c + 1) == '\n');
+      start = c + 1;
+      ++line;
+   }
+
+   return true;
+}
+
 static char
 advance(struct state *state, bool skip_whitespace)
 {
@@ -87,10 +276,11 @@ advance(struct state *state, bool skip_whitespace)
       return 0;
 
    do {
-      if (++state->cursor && !state_end(state) && is_eol(*state->cursor)) {
-         state->cursor += (*(state->cursor - 1) == '\r' && *state->cursor == '\n');
+      // line is counted when stepping off the line break, so breaks reached by moving cursor directly count too
+      const char prev = *state->cursor++;
+      if (is_eol(prev) && (prev != '\r' || state_end(state) || *state->cursor != '\n')) {
          ++state->line;
-         state->line_start = state->cursor + 1;
+         state->line_start = state->cursor;
       }
    } while (!state_end(state) && (is_eol(*state->cursor) || (skip_whitespace && isspace(*state->cursor)) || !*state->cursor));
 
@@ -205,261 +395,1427 @@ escape_eol(struct state *state, size_t *line)
 
    advance(state, true);
    *line = state->line;
-   --state->cursor;
+
+   // caller's advance steps back off the line break, which must not count the line twice
+   if (is_eol(*--state->cursor))
+      --state->line;
+
    return true;
 }
 
-static bool
-set_value(struct ini *ini, const struct state *before, struct state *state, struct chck_iter_pool *pool)
+static INI_CONST size_t
+slots_for(size_t count)
 {
-   assert(ini && state);
-
-   struct chck_string path = {0};
-   const char *section = (chck_string_is_empty(&state->section) ? "" : state->section.data);
-   if (!chck_string_set_format(&path, "%.*s%c%.*s", (int)state->section.size, section, ini->delim, (int)state->key.size, state->key.data)) {
-      throw(ini, before, "Could not set key '%s.%s' (out of memory?)", section, state->key.data);
-      return false;
-   }
+   // keep load factor at most 1/2, so probing always hits empty slot quickly
+   size_t size = 8;
+   while (size < count * 2)
+      size <<= 1;
+   return size;
+}
 
-   if (chck_hash_table_str_get(&ini->data->table, path.data, path.size)) {
-      throw(ini, before, "Key '%s' is already set", path.data);
-      goto error0;
-   }
+static INI_PURE struct entry*
+table_entry(const struct table *table, size_t index)
+{
+   assert(table && index < table->allocated);
+   return &table->chunks[index / ENTRIES_PER_CHUNK][index % ENTRIES_PER_CHUNK];
+}
 
-   struct chck_string value = {0};
+static INI_PURE uint32_t
+slots_get(const struct slot *slots, size_t size, const struct table *table, const char *path, size_t len, uint32_t hash)
+{
+   assert(slots && table && path);
 
-   if (pool) {
-      // make sure value is null terminated
-      if (pool->items.count > 0 && *(char*)chck_iter_pool_get_last(pool) != 0)
-         chck_iter_pool_push_back(pool, "");
+   const size_t mask = size - 1;
+   for (size_t s = hash & mask; slots[s].index; s = (s + 1) & mask) {
+      if (slots[s].hash != hash)
+         continue;
 
-      // steal ownership from pool
-      chck_string_set_cstr_with_length(&value, (void*)pool->items.buffer, pool->items.count, false);
-      value.is_heap = true;
-      pool->items.buffer = NULL;
+      const struct entry *entry = table_entry(table, slots[s].index - 1);
+      if (entry->path.size == len && !memcmp(entry->path.data, path, len))
+         return slots[s].index;
    }
 
-   if (!chck_hash_table_str_set(&ini->data->table, path.data, path.size, &value))
-      goto error1;
-
-   chck_string_release(&path);
-   return true;
-
-error1:
-   chck_string_release(&value);
-error0:
-   chck_string_release(&path);
-   return false;
+   return 0;
 }
 
-static bool
-parse_value(struct ini *ini, struct state *state)
+static INI_PURE uint32_t
+table_find(const struct table *table, const char *path, size_t len, uint32_t hash)
 {
-   assert(ini && state);
-   assert(*state->cursor == '=');
+   assert(table && path);
 
-   struct chck_iter_pool pool;
-   chck_iter_pool(&pool, 32, 0, sizeof(char));
+   if (!table->count)
+      return 0;
 
-   struct state before = *state;
-   size_t line = state->line;
-   bool started = false, is_quoted = false;
-   while (advance(state, false)) {
-      if (is_quoted && *state->cursor == '"') {
-         break;
-      } else if (state->line != line) {
-         if (is_quoted) {
-            chck_iter_pool_push_back(&pool, "\n");
-            line = state->line;
-         } else {
-            break;
-         }
-      }
+   // old slots are never cleared while migrating, so their probe chains stay intact
+   uint32_t index;
+   if (!(index = slots_get(table->slots, table->size, table, path, len, hash)) && table->old)
+      index = slots_get(table->old, table->old_size, table, path, len, hash);
 
-      if (escape_eol(state, &line) || (!started && isspace(*state->cursor)))
-         continue;
+   return index;
+}
 
-      if (!started && *state->cursor == '"') {
-         is_quoted = true;
-         continue;
-      }
+static INI_PURE struct entry*
+table_get(const struct table *table, const char *path, size_t len, uint32_t hash)
+{
+   assert(table && path);
+   const uint32_t index = table_find(table, path, len, hash);
+   return (index ? table_entry(table, index - 1) : NULL);
+}
 
-      decode_escaped(ini, state, &pool);
-      started = true;
+static size_t
+table_get_many(const struct table *table, const struct ini_key *keys, size_t n, struct ini_value *out_values)
+{
+   assert(table && keys && out_values);
+
+   // Each lookup is a chain of dependent loads (slot -> entry -> path string).
+   // Walk the chain one level at a time for all keys, so the cache misses overlap.
+   const size_t mask = table->size - 1;
+   for (size_t i = 0; i < n; ++i)
+      prefetch(&table->slots[keys[i].hash & mask]);
+
+   for (size_t i = 0; i < n; ++i) {
+      const struct slot *slot = &table->slots[keys[i].hash & mask];
+      if (slot->index && slot->hash == keys[i].hash)
+         prefetch(table_entry(table, slot->index - 1));
    }
 
-   if (is_quoted) {
-      assert(state_end(state) || *state->cursor == '"');
+   for (size_t i = 0; i < n; ++i) {
+      const struct slot *slot = &table->slots[keys[i].hash & mask];
+      if (slot->index && slot->hash == keys[i].hash)
+         prefetch(table_entry(table, slot->index - 1)->path.data);
+   }
 
-      if (state_end(state) || *state->cursor != '"') {
-         throw(ini, &before, "Unterminated quoted string");
-         goto error0;
+   size_t found = 0;
+   for (size_t i = 0; i < n; ++i) {
+      const struct entry *entry;
+      if ((entry = table_get(table, keys[i].path, keys[i].size, keys[i].hash))) {
+         out_values[i] = (struct ini_value){ entry->value.data, entry->value.size };
+         ++found;
+      } else {
+         out_values[i] = (struct ini_value){ NULL, 0 };
       }
-
-      // skip ending "
-      ++state->cursor;
-   } else {
-      assert(state_end(state) || state->line != line);
    }
 
-   if (!started) {
-      if (!state->options.empty_values) {
-         throw(ini, &before, "Value should not be empty");
-         goto error0;
-      }
+   return found;
+}
 
-      goto out;
+static void
+slots_insert(struct slot *slots, size_t size, struct slot slot)
+{
+   assert(slots && slot.index);
+   const size_t mask = size - 1;
+   size_t s = slot.hash & mask;
+   while (slots[s].index) s = (s + 1) & mask;
+   slots[s] = slot;
+}
+
+static void
+table_migrate(struct table *table, size_t steps)
+{
+   assert(table);
+
+   if (!table->old)
+      return;
+
+   for (; steps > 0 && table->migrated < table->old_size; --steps, ++table->migrated) {
+      if (table->old[table->migrated].index)
+         slots_insert(table->slots, table->size, table->old[table->migrated]);
    }
 
-out: ; // stupid C standard
-   const bool ret = set_value(ini, &before, state, &pool);
-   chck_iter_pool_release(&pool);
-   return ret;
+   if (table->migrated < table->old_size)
+      return;
 
-error0:
-   chck_iter_pool_release(&pool);
-   return false;
+   free(table->old);
+   table->old = NULL;
+   table->old_size = table->migrated = 0;
 }
 
 static bool
-parse_key(struct ini *ini, struct state *state)
+table_grow(struct table *table, size_t size)
 {
-   assert(ini && state);
-   assert(*state->cursor != '[' && *state->cursor != '#' && *state->cursor != ';');
+   assert(table && size > table->size && !(size & (size - 1)));
 
-   struct state before = *state;
-   bool invalid_characters = false;
-   bool has_whitespace = false;
-   const char *start = state->cursor, *last = state->cursor, *end = NULL;
-   while (advance(state, has_whitespace) && *state->cursor != '=' && state->line == before.line) {
-      if (*state->cursor == ini->delim) {
-         invalid_characters = true;
-      } else if (isspace(*state->cursor)) {
-         has_whitespace = (end ? true : false);
-         end = state->cursor;
-      } else {
-         last = (end ? end : state->cursor);
-      }
-   }
+   // only one migration at a time
+   table_migrate(table, SIZE_MAX);
 
-   if (state_end(state))
+   struct slot *slots;
+   if (!(slots = calloc(size, sizeof(struct slot))))
       return false;
 
-   // valueless key in other words
-   bool is_empty_key = false;
+   if (!table->count) {
+      // nothing to move
+      free(table->slots);
+   } else {
+      // old slots are moved over a few at a time by table_set, so the pause stays bounded
+      table->old = table->slots;
+      table->old_size = table->size;
+      table->migrated = 0;
+   }
 
-   if (*state->cursor != '=') {
-      if (!state->options.empty_keys) {
-         throw(ini, &before, "Key does not end up with '='");
-         return false;
-      } else if (!has_whitespace) {
-         has_whitespace = is_eol_or_space(*last);
-      }
+   table->slots = slots;
+   table->size = size;
+   return true;
+}
 
-      is_empty_key = true;
-   }
+static bool
+table_reserve_entries(struct table *table, size_t count)
+{
+   assert(table);
 
-   if (!is_empty_key && state->line != before.line) {
-      throw(ini, &before, "Key contains newline");
-      return false;
-   }
+   if (count <= table->allocated)
+      return true;
 
-   if (has_whitespace) {
-      throw(ini, &before, "Key contains whitespace");
-      return false;
-   }
+   // only the array of chunk pointers is reallocated, entries stay where they are
+   const size_t have = table->allocated / ENTRIES_PER_CHUNK, chunks = (count + ENTRIES_PER_CHUNK - 1) / ENTRIES_PER_CHUNK;
 
-   if (invalid_characters) {
-      throw(ini, state, "Key contains invalid characters [%c]", ini->delim);
+   struct entry **array;
+   if (chunks > SIZE_MAX / sizeof(struct entry*) || !(array = realloc(table->chunks, chunks * sizeof(struct entry*))))
       return false;
-   }
 
-   if (last - start > INT_MAX) {
-      throw(ini, state, "Key name too long");
-      return false;
+   table->chunks = array;
+
+   for (size_t i = have; i < chunks; ++i) {
+      if (!(array[i] = malloc(ENTRIES_PER_CHUNK * sizeof(struct entry))))
+         return false;
+
+      table->allocated += ENTRIES_PER_CHUNK;
    }
 
-   if (last >= start)
-      chck_string_set_cstr_with_length(&state->key, start, last + 1 - start, false);
+   return true;
+}
 
-   if (chck_string_is_empty(&state->key)) {
-      throw(ini, state, "Key is empty");
+static bool
+table_reserve(struct table *table, size_t count)
+{
+   assert(table);
+
+   if (count >= UINT32_MAX - 1)
       return false;
-   }
 
-   return (is_empty_key ? set_value(ini, &before, state, NULL) : parse_value(ini, state));
+   // entries grow a chunk at a time without copying, only slots are worth reserving up front
+   const size_t size = slots_for(count);
+   return (size <= table->size || table_grow(table, size));
 }
 
 static bool
-parse_section(struct ini *ini, struct state *state)
+table_set(struct table *table, uint32_t hash, const struct chck_string *path, const struct chck_string *value)
 {
-   assert(ini && state);
-   assert(*state->cursor == '[');
+   assert(table && path && value);
 
-   struct state before = *state;
-   bool has_whitespace = false;
-   const char *start = state->cursor + 1;
-   while (advance(state, has_whitespace) && *state->cursor != ']' && state->line == before.line) {
-      if (isspace(*state->cursor))
-         has_whitespace = true;
-   }
+   if (table->count >= UINT32_MAX - 1)
+      return false;
 
-   if (state_end(state))
+   // Grown table has at least twice the slots, so it takes count / 2 inserts before it needs to grow again.
+   // Moving 2 old slots per insert would be enough to finish migration before that, move some more.
+   if ((table->count + 1) * 2 > table->size && !table_grow(table, table->size * 2))
       return false;
 
-   if (*state->cursor != ']') {
-      throw(ini, &before, "Section does not end up with ']'");
+   if (table->count >= table->allocated && !table_reserve_entries(table, table->count + 1))
       return false;
-   }
 
-   // skip ending ] so we do not try to parse it
-   ++state->cursor;
+   table_migrate(table, 32);
+   *table_entry(table, table->count) = (struct entry){ *path, *value };
+   slots_insert(table->slots, table->size, (struct slot){ hash, (uint32_t)++table->count });
+   return true;
+}
+
+static void
+table_flush(struct table *table)
+{
+   assert(table);
+
+   for (size_t i = 0; i < table->count; ++i) {
+      struct entry *entry = table_entry(table, i);
+      chck_string_release(&entry->path);
+      chck_string_release(&entry->value);
+   }
+
+   free(table->old);
+   table->old = NULL;
+   table->old_size = table->migrated = 0;
+   memset(table->slots, 0, table->size * sizeof(struct slot));
+   table->count = 0;
+}
+
+static void
+table_release(struct table *table)
+{
+   if (!table)
+      return;
+
+   if (table->slots)
+      table_flush(table);
+
+   for (size_t i = 0; i < table->allocated / ENTRIES_PER_CHUNK; ++i)
+      free(table->chunks[i]);
+
+   free(table->chunks);
+   free(table->slots);
+   memset(table, 0, sizeof(struct table));
+}
+
+static INI_PURE struct ini_value
+static_value(const struct ini_static *table, const struct ini_static_entry *entry)
+{
+   assert(table && entry);
+   return (struct ini_value){ (entry->size ? table->strings + entry->data : NULL), entry->size };
+}
+
+static INI_PURE const struct ini_static_entry*
+static_get(const struct ini_static *table, const char *path, size_t len, uint32_t hash)
+{
+   assert(table && path);
+
+   if (!table->count)
+      return NULL;
+
+   const uint32_t seed = table->seeds[hash % table->buckets];
+   for (size_t i = table->slots[hash_seed(hash, seed) % table->size]; i < table->count && table->entries[i].hash == hash; ++i) {
+      const struct ini_static_entry *entry = &table->entries[i];
+      if (entry->path_size == len && !memcmp(table->strings + entry->path, path, len))
+         return entry;
+   }
+
+   return NULL;
+}
+
+static size_t
+static_get_many(const struct ini_static *table, const struct ini_key *keys, size_t n, struct ini_value *out_values)
+{
+   assert(table && keys && out_values);
+
+   if (!table->count) {
+      memset(out_values, 0, n * sizeof(struct ini_value));
+      return 0;
+   }
+
+   // same staged prefetching as table_get_many (seed -> slot -> entry)
+   for (size_t i = 0; i < n; ++i)
+      prefetch(&table->seeds[keys[i].hash % table->buckets]);
+
+   for (size_t i = 0; i < n; ++i)
+      prefetch(&table->slots[hash_seed(keys[i].hash, table->seeds[keys[i].hash % table->buckets]) % table->size]);
+
+   for (size_t i = 0; i < n; ++i)
+      prefetch(&table->entries[table->slots[hash_seed(keys[i].hash, table->seeds[keys[i].hash % table->buckets]) % table->size]]);
+
+   size_t found = 0;
+   for (size_t i = 0; i < n; ++i) {
+      const struct ini_static_entry *entry;
+      if ((entry = static_get(table, keys[i].path, keys[i].size, keys[i].hash))) {
+         out_values[i] = static_value(table, entry);
+         ++found;
+      } else {
+         out_values[i] = (struct ini_value){ NULL, 0 };
+      }
+   }
+
+   return found;
+}
+
+static bool
+table(struct table *table, size_t count)
+{
+   assert(table);
+   memset(table, 0, sizeof(struct table));
+   table->size = slots_for(count);
+   return (table->slots = calloc(table->size, sizeof(struct slot)));
+}
+
+static bool
+insert(struct ini *ini, const struct state *before, const struct chck_string *section, const struct chck_string *key, struct chck_string *value)
+{
+   assert(ini && before && section && key && value);
+
+   if (before->options.max_keys && ++before->limits->keys > before->options.max_keys) {
+      throw(ini, before, "Number of keys exceeds limit of %zu", before->options.max_keys);
+      before->limits->exceeded = true;
+      goto error1;
+   }
+
+   struct chck_string path = {0};
+   const char *sname = (chck_string_is_empty(section) ? "" : section->data);
+   if (!chck_string_set_format(&path, "%.*s%c%.*s", (int)section->size, sname, ini->delim, (int)key->size, key->data)) {
+      throw(ini, before, "Could not set key '%s.%s' (out of memory?)", sname, key->data);
+      goto error1;
+   }
+
+   const uint32_t hash = hash_str(path.data, path.size);
+   if (table_get(&ini->data->table, path.data, path.size, hash)) {
+      throw(ini, before, "Key '%s' is already set", path.data);
+      goto error0;
+   }
+
+   // table takes ownership of both path and value
+   if (!table_set(&ini->data->table, hash, &path, value)) {
+      throw(ini, before, "Could not set key '%s' (out of memory?)", path.data);
+      goto error0;
+   }
+
+   if (before->options.interpolation && value->data && memchr(value->data, '$', value->size)) {
+      struct pending pending = {
+         .entry = ini->data->table.count - 1,
+         .line = before->line,
+         .position = (size_t)(before->cursor - before->line_start + 1),
+         .status = PENDING,
+      };
+
+      copy_line(before, pending.text, sizeof(pending.text));
+
+      if ((before->includes && !(pending.file = strdup(before->file))) || !chck_iter_pool_push_back(&ini->data->pending, &pending)) {
+         throw(ini, before, "Could not interpolate key '%s' (out of memory?)", table_entry(&ini->data->table, pending.entry)->path.data);
+         free(pending.file);
+         return false;
+      }
+   }
+
+   return true;
+
+error0:
+   chck_string_release(&path);
+error1:
+   chck_string_release(value);
+   return false;
+}
+
+static bool
+copy_string(struct chck_string *dst, const struct chck_string *src)
+{
+   assert(dst && src);
+   memset(dst, 0, sizeof(struct chck_string));
+
+   if (!src->data)
+      return true;
+
+   // sizes of values already include null terminator, so plain copy of size + 1 is always safe
+   if (!(dst->data = malloc(src->size + 1)))
+      return false;
+
+   memcpy(dst->data, src->data, src->size);
+   dst->data[src->size] = 0;
+   dst->size = src->size;
+   dst->is_heap = true;
+   return true;
+}
+
+static void
+record_release(struct record *record)
+{
+   if (!record)
+      return;
+
+   chck_string_release(&record->section);
+   chck_string_release(&record->key);
+   chck_string_release(&record->value);
+}
+
+static bool
+push_record(struct ini *ini, const struct state *before, struct state *state, struct chck_string *value, bool include)
+{
+   assert(ini && before && state && state->fragment && value);
+
+   if (state->options.max_keys && state->fragment->records.items.count >= state->options.max_keys) {
+      throw(ini, before, "Number of keys exceeds limit of %zu", state->options.max_keys);
+      state->limits->exceeded = true;
+      chck_string_release(value);
+      return false;
+   }
+
+   struct record record = {
+      .line = before->line,
+      .line_start = (size_t)(before->line_start - before->buffer),
+      .cursor = (size_t)(before->cursor - before->buffer),
+      .value = *value,
+      .include = include,
+   };
+
+   if (!copy_string(&record.section, &state->section) || !copy_string(&record.key, &state->key) ||
+       !chck_iter_pool_push_back(&state->fragment->records, &record)) {
+      throw(ini, before, "Could not set key '%s' (out of memory?)", (record.key.data ? record.key.data : ""));
+      record_release(&record);
+      return false;
+   }
+
+   return true;
+}
+
+static bool
+set_value(struct ini *ini, const struct state *before, struct state *state, struct chck_iter_pool *pool)
+{
+   assert(ini && state);
+
+   struct chck_string value = {0};
+
+   if (pool) {
+      // make sure value is null terminated
+      if (pool->items.count > 0 && *(char*)chck_iter_pool_get_last(pool) != 0)
+         chck_iter_pool_push_back(pool, "");
+
+      // steal ownership from pool
+      chck_string_set_cstr_with_length(&value, (void*)pool->items.buffer, pool->items.count, false);
+      value.is_heap = true;
+      pool->items.buffer = NULL;
+   }
+
+   if (state->fragment)
+      return push_record(ini, before, state, &value, false);
+
+   return insert(ini, before, &state->section, &state->key, &value);
+}
+
+static bool
+parse_value(struct ini *ini, struct state *state)
+{
+   assert(ini && state);
+   assert(*state->cursor == '=');
+
+   struct chck_iter_pool pool;
+   chck_iter_pool(&pool, 32, 0, sizeof(char));
+
+   struct state before = *state;
+   size_t line = state->line, bytes = 0;
+   bool started = false, is_quoted = false;
+   while (advance(state, false)) {
+      if (sample_deadline(ini, state, &bytes))
+         goto error0;
+
+      if (is_quoted && *state->cursor == '"') {
+         break;
+      } else if (state->line != line) {
+         if (is_quoted) {
+            chck_iter_pool_push_back(&pool, "\n");
+            line = state->line;
+         } else {
+            break;
+         }
+      }
+
+      if (escape_eol(state, &line) || (!started && isspace(*state->cursor)))
+         continue;
+
+      if (!started && *state->cursor == '"') {
+         is_quoted = true;
+         continue;
+      }
+
+      decode_escaped(ini, state, &pool);
+      started = true;
+
+      if (state->options.max_value_length && pool.items.count > state->options.max_value_length) {
+         throw(ini, &before, "Value exceeds limit of %zu bytes", state->options.max_value_length);
+         state->limits->exceeded = true;
+         goto error0;
+      }
+   }
+
+   if (is_quoted) {
+      assert(state_end(state) || *state->cursor == '"');
+
+      if (state_end(state) || *state->cursor != '"') {
+         throw(ini, &before, "Unterminated quoted string");
+         goto error0;
+      }
+
+      // skip ending "
+      ++state->cursor;
+   } else {
+      assert(state_end(state) || state->line != line);
+   }
+
+   if (!started) {
+      if (!state->options.empty_values) {
+         throw(ini, &before, "Value should not be empty");
+         goto error0;
+      }
+
+      goto out;
+   }
+
+out: ; // stupid C standard
+   const bool ret = set_value(ini, &before, state, &pool);
+   chck_iter_pool_release(&pool);
+   return ret;
+
+error0:
+   chck_iter_pool_release(&pool);
+   return false;
+}
+
+static bool
+parse_key(struct ini *ini, struct state *state)
+{
+   assert(ini && state);
+   assert(*state->cursor != '[' && *state->cursor != '#' && *state->cursor != ';');
+
+   struct state before = *state;
+   bool invalid_characters = false;
+   bool has_whitespace = false;
+   const char *start = state->cursor, *last = state->cursor, *end = NULL;
+   size_t bytes = 0;
+   while (advance(state, has_whitespace) && *state->cursor != '=' && state->line == before.line) {
+      if (sample_deadline(ini, state, &bytes))
+         return false;
+
+      if (*state->cursor == ini->delim) {
+         invalid_characters = true;
+      } else if (isspace(*state->cursor)) {
+         has_whitespace = (end ? true : false);
+         end = state->cursor;
+      } else {
+         last = (end ? end : state->cursor);
+      }
+   }
+
+   if (state_end(state))
+      return false;
+
+   // valueless key in other words
+   bool is_empty_key = false;
+
+   if (*state->cursor != '=') {
+      if (!state->options.empty_keys) {
+         throw(ini, &before, "Key does not end up with '='");
+         return false;
+      } else if (!has_whitespace) {
+         has_whitespace = is_eol_or_space(*last);
+      }
+
+      is_empty_key = true;
+   }
+
+   if (!is_empty_key && state->line != before.line) {
+      throw(ini, &before, "Key contains newline");
+      return false;
+   }
+
+   if (has_whitespace) {
+      throw(ini, &before, "Key contains whitespace");
+      return false;
+   }
+
+   if (invalid_characters) {
+      throw(ini, state, "Key contains invalid characters [%c]", ini->delim);
+      return false;
+   }
+
+   if (last - start > INT_MAX) {
+      throw(ini, state, "Key name too long");
+      return false;
+   }
+
+   if (last >= start)
+      chck_string_set_cstr_with_length(&state->key, start, last + 1 - start, false);
+
+   if (chck_string_is_empty(&state->key)) {
+      throw(ini, state, "Key is empty");
+      return false;
+   }
+
+   return (is_empty_key ? set_value(ini, &before, state, NULL) : parse_value(ini, state));
+}
+
+static bool
+parse_section(struct ini *ini, struct state *state)
+{
+   assert(ini && state);
+   assert(*state->cursor == '[');
+
+   struct state before = *state;
+   bool has_whitespace = false;
+   const char *start = state->cursor + 1;
+   size_t bytes = 0;
+   while (advance(state, has_whitespace) && *state->cursor != ']' && state->line == before.line) {
+      if (sample_deadline(ini, state, &bytes))
+         return false;
+
+      if (isspace(*state->cursor))
+         has_whitespace = true;
+   }
+
+   if (state_end(state))
+      return false;
+
+   if (*state->cursor != ']') {
+      throw(ini, &before, "Section does not end up with ']'");
+      return false;
+   }
+
+   // skip ending ] so we do not try to parse it
+   ++state->cursor;
+
+   if (state->line != before.line) {
+      throw(ini, &before, "Section contains newline");
+      return false;
+   }
+
+   if (has_whitespace) {
+      throw(ini, state, "Section contains whitespace");
+      return false;
+   }
+
+   if (state->cursor - start > INT_MAX) {
+      throw(ini, state, "Section name too long");
+      return false;
+   }
+
+   if (state->cursor > start)
+      chck_string_set_cstr_with_length(&state->section, start, state->cursor - 1 - start, false);
+
+   if (chck_string_is_empty(&state->section)) {
+      throw(ini, state, "Section is empty");
+      return false;
+   }
+
+   // included files count their sections when grafted, so it doesn't matter whether they were cached
+   size_t *sections = (state->fragment ? &state->fragment->sections : &state->limits->sections);
+   if (state->options.max_sections && ++*sections > state->options.max_sections) {
+      throw(ini, &before, "Number of sections exceeds limit of %zu", state->options.max_sections);
+      state->limits->exceeded = true;
+      return false;
+   }
+
+   return true;
+}
+
+static bool
+parse_comment(struct ini *ini, struct state *state)
+{
+   (void)ini;
+   assert(ini && state);
+   assert(*state->cursor == '#' || *state->cursor == ';');
+   size_t line = state->line, bytes = 0;
+   while (advance(state, true) && state->line == line) {
+      if (sample_deadline(ini, state, &bytes))
+         return false;
+
+      escape_eol(state, &line);
+   }
+
+   assert(state_end(state) || state->line != line);
+   return true;
+}
+
+static char
+next(struct state *state)
+{
+   if (state_end(state))
+      return 0;
+
+   return (!is_eol_or_space(*state->cursor) ? *state->cursor : advance(state, true));
+}
+
+static void
+throw_pending(struct ini *ini, const struct pending *pending, const char *fmt, ...)
+{
+   assert(ini && pending && fmt);
+
+   if (!ini->throw)
+      return;
+
+   va_list args;
+   va_start(args, fmt);
+   throw_at(ini, pending->file, pending->line, pending->position, pending->text, fmt, args);
+   va_end(args);
+}
+
+static INI_PURE struct pending*
+pending_get(const struct ini *ini, size_t entry)
+{
+   assert(ini);
+
+   size_t lo = 0, hi = ini->data->pending.items.count;
+   while (lo < hi) {
+      const size_t mid = lo + (hi - lo) / 2;
+      struct pending *p = chck_iter_pool_get(&ini->data->pending, mid);
+      if (p->entry == entry)
+         return p;
+
+      if (p->entry < entry)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+
+   return NULL;
+}
+
+static bool
+push_str(struct chck_iter_pool *pool, const char *str, size_t len)
+{
+   assert(pool && (str || !len));
+
+   for (size_t i = 0; i < len; ++i)
+      if (!chck_iter_pool_push_back(pool, str + i))
+         return false;
+
+   return true;
+}
+
+static const char env_prefix[] = "ENV:";
+
+static INI_PURE bool
+is_env_reference(const char *ref, size_t len)
+{
+   assert(ref);
+   return (len >= sizeof(env_prefix) - 1 && !memcmp(ref, env_prefix, sizeof(env_prefix) - 1));
+}
+
+static bool
+find_reference(struct ini *ini, const struct pending *pending, const char *ref, size_t len, struct chck_string *out_path, uint32_t *out_index)
+{
+   assert(ini && pending && ref && out_path && out_index);
+
+   // references without section are relative to section of the key
+   const struct chck_string *self = &table_entry(&ini->data->table, pending->entry)->path;
+   const bool ok = (memchr(ref, ini->delim, len) ?
+         chck_string_set_format(out_path, "%.*s", (int)len, ref) :
+         chck_string_set_format(out_path, "%.*s%.*s", (int)(strrchr(self->data, ini->delim) + 1 - self->data), self->data, (int)len, ref));
+
+   if (!ok)
+      return false;
+
+   *out_index = table_find(&ini->data->table, out_path->data, out_path->size, hash_str(out_path->data, out_path->size));
+   return true;
+}
+
+static bool
+expand_reference(struct ini *ini, struct pending *pending, const char *ref, size_t len, struct chck_iter_pool *pool)
+{
+   assert(ini && pending && ref && pool);
+
+   if (is_env_reference(ref, len)) {
+      struct chck_string name = {0};
+      if (!chck_string_set_format(&name, "%.*s", (int)(len - (sizeof(env_prefix) - 1)), ref + sizeof(env_prefix) - 1)) {
+         throw_pending(ini, pending, "Could not expand '%.*s' (out of memory?)", (int)len, ref);
+         return false;
+      }
+
+      const char *value;
+      if (chck_string_is_empty(&name) || !(value = getenv(name.data))) {
+         throw_pending(ini, pending, "Undefined environment variable '%.*s'", (int)len, ref);
+         chck_string_release(&name);
+         return false;
+      }
+
+      chck_string_release(&name);
+      return push_str(pool, value, strlen(value));
+   }
+
+   uint32_t index;
+   struct chck_string path = {0};
+   if (!find_reference(ini, pending, ref, len, &path, &index)) {
+      throw_pending(ini, pending, "Could not expand '%.*s' (out of memory?)", (int)len, ref);
+      return false;
+   }
+
+   if (!index) {
+      throw_pending(ini, pending, "Undefined reference '%s'", path.data);
+      chck_string_release(&path);
+      return false;
+   }
+
+   // dependencies are resolved first, so one still resolving references back to this value
+   const struct pending *dep;
+   if ((dep = pending_get(ini, index - 1)) && dep->status != RESOLVED) {
+      assert(dep->status == RESOLVING || dep->status == FAILED);
+
+      if (dep->status == RESOLVING)
+         throw_pending(ini, pending, "Reference cycle through '%s'", path.data);
+      else
+         throw_pending(ini, pending, "Reference to invalid value '%s'", path.data);
+
+      chck_string_release(&path);
+      return false;
+   }
+
+   chck_string_release(&path);
+
+   // resolving may have replaced the value, so look it up only now
+   const struct entry *entry = table_entry(&ini->data->table, index - 1);
+
+   // value sizes include the null terminator
+   const size_t size = (entry->value.size > 0 && !entry->value.data[entry->value.size - 1] ? entry->value.size - 1 : entry->value.size);
+   return push_str(pool, entry->value.data, size);
+}
+
+static bool
+work_push(struct work *work, size_t index)
+{
+   assert(work);
+
+   if (work->count >= work->allocated) {
+      const size_t allocated = (work->allocated ? work->allocated * 2 : 32);
+
+      size_t *items;
+      if (!(items = realloc(work->items, allocated * sizeof(size_t))))
+         return false;
+
+      work->items = items;
+      work->allocated = allocated;
+   }
+
+   work->items[work->count++] = index;
+   return true;
+}
+
+static bool
+push_dependencies(struct ini *ini, const struct pending *pending, struct work *work)
+{
+   assert(ini && pending && work);
+
+   // malformed references are skipped here and reported when the value is expanded
+   const struct chck_string *value = &table_entry(&ini->data->table, pending->entry)->value;
+   for (size_t i = 0; i + 1 < value->size; ++i) {
+      const char *c = value->data + i, *end;
+
+      if (*c != '$' || (c[1] != '$' && c[1] != '{'))
+         continue;
+
+      if (c[1] == '$') {
+         ++i;
+         continue;
+      }
+
+      if (!(end = memchr(c + 2, '}', value->size - i - 2)))
+         break;
+
+      i = end - value->data;
+      if (end == c + 2 || is_env_reference(c + 2, end - c - 2))
+         continue;
+
+      uint32_t index;
+      struct chck_string path = {0};
+      const bool ok = find_reference(ini, pending, c + 2, end - c - 2, &path, &index);
+      chck_string_release(&path);
+
+      if (!ok)
+         return false;
+
+      const struct pending *dep;
+      if (index && (dep = pending_get(ini, index - 1)) && dep->status == PENDING &&
+          !work_push(work, dep - (const struct pending*)ini->data->pending.items.buffer))
+         return false;
+   }
+
+   return true;
+}
+
+static bool
+expand(struct ini *ini, const struct state *state, struct pending *pending)
+{
+   assert(ini && state && pending && pending->status == RESOLVING);
+
+   struct chck_iter_pool pool;
+   chck_iter_pool(&pool, 32, 0, sizeof(char));
+
+   bool valid = true;
+   const struct chck_string *value = &table_entry(&ini->data->table, pending->entry)->value;
+   for (size_t i = 0; valid && i < value->size; ++i) {
+      const char *c = value->data + i;
+
+      if (*c != '$' || i + 1 >= value->size || (c[1] != '$' && c[1] != '{')) {
+         valid = (chck_iter_pool_push_back(&pool, c) != NULL);
+         continue;
+      }
+
+      // $$ is literal $
+      if (c[1] == '$') {
+         valid = (chck_iter_pool_push_back(&pool, c) != NULL);
+         ++i;
+         continue;
+      }
+
+      const char *end;
+      if (!(end = memchr(c + 2, '}', value->size - i - 2))) {
+         throw_pending(ini, pending, "Unterminated reference");
+         valid = false;
+         break;
+      }
+
+      if (end == c + 2) {
+         throw_pending(ini, pending, "Reference is empty");
+         valid = false;
+         break;
+      }
+
+      valid = expand_reference(ini, pending, c + 2, end - c - 2, &pool);
+      i = end - value->data;
+
+      // references can nest, so expanded values may grow exponentially
+      if (valid && state->options.max_value_length && pool.items.count > state->options.max_value_length) {
+         throw_pending(ini, pending, "Value exceeds limit of %zu bytes", state->options.max_value_length);
+         state->limits->exceeded = true;
+         valid = false;
+      }
+
+      // expanded values count as input, so max_bytes bounds memory even without max_value_length
+      if (valid && state->options.max_bytes && state->limits->bytes + pool.items.count > state->options.max_bytes) {
+         throw_pending(ini, pending, "Input exceeds limit of %zu bytes", state->options.max_bytes);
+         state->limits->exceeded = true;
+         valid = false;
+      }
+
+      // single reference may copy a lot, so clock is read for every one
+      if (valid && past_deadline_now(ini, state))
+         valid = false;
+   }
+
+   // memoize expanded value in the table, so reads cost the same as for plain values
+   if (valid) {
+      if (pool.items.count > 0 && *(char*)chck_iter_pool_get_last(&pool) != 0)
+         valid = (chck_iter_pool_push_back(&pool, "") != NULL);
+
+      if (valid) {
+         struct chck_string *v = &table_entry(&ini->data->table, pending->entry)->value;
+         chck_string_release(v);
+         chck_string_set_cstr_with_length(v, (void*)pool.items.buffer, pool.items.count, false);
+         v->is_heap = true;
+         state->limits->bytes += pool.items.count;
+         pool.items.buffer = NULL;
+      }
+   }
+
+   chck_iter_pool_release(&pool);
+   pending->status = (valid ? RESOLVED : FAILED);
+   return valid;
+}
+
+static bool
+resolve(struct ini *ini, const struct state *state, size_t root, struct work *work)
+{
+   assert(ini && state && work);
+
+   // depth first, value on top of the stack gets expanded once everything pushed above it is done
+   work->count = 0;
+   if (!work_push(work, root)) {
+      throw_pending(ini, chck_iter_pool_get(&ini->data->pending, root), "Could not resolve value (out of memory?)");
+      return false;
+   }
+
+   while (work->count > 0 && !past_deadline(ini, state)) {
+      struct pending *pending = chck_iter_pool_get(&ini->data->pending, work->items[work->count - 1]);
+
+      if (pending->status == PENDING) {
+         pending->status = RESOLVING;
+         if (!push_dependencies(ini, pending, work)) {
+            throw_pending(ini, pending, "Could not resolve value (out of memory?)");
+            pending->status = FAILED;
+         }
+         continue;
+      }
+
+      if (pending->status == RESOLVING)
+         expand(ini, state, pending);
+
+      --work->count;
+   }
+
+   return (((struct pending*)chck_iter_pool_get(&ini->data->pending, root))->status == RESOLVED);
+}
+
+static bool
+interpolate(struct ini *ini, const struct state *state)
+{
+   assert(ini && state);
+
+   if (!ini->data->pending.items.count)
+      return true;
+
+   bool valid = true;
+   struct work work = {0};
+   for (size_t i = 0; i < ini->data->pending.items.count && !state->limits->exceeded; ++i) {
+      if (!resolve(ini, state, i, &work))
+         valid = false;
+   }
+
+   free(work.items);
+
+   for (size_t i = 0; i < ini->data->pending.items.count; ++i)
+      free(((struct pending*)chck_iter_pool_get(&ini->data->pending, i))->file);
+
+   chck_iter_pool_release(&ini->data->pending);
+   chck_iter_pool(&ini->data->pending, 32, 0, sizeof(struct pending));
+   return valid;
+}
+
+static bool
+read_file(const char *path, size_t max_size, char **out_buffer, size_t *out_size)
+{
+   assert(path && out_buffer && out_size);
+
+   // out_size is left set when file is bigger than max_size, so caller can tell it apart from read errors
+   *out_size = 0;
+
+   FILE *f;
+   if (!(f = fopen(path, "rb")))
+      return false;
+
+   fseek(f, 0, SEEK_END);
+   const long size = ftell(f);
+   fseek(f, 0, SEEK_SET);
+
+   if (size > 0 && (unsigned long)size > max_size) {
+      *out_size = size;
+      goto error0;
+   }
+
+   char *buffer;
+   if (size < 0 || !(buffer = malloc(size + 1)))
+      goto error0;
 
-   if (state->line != before.line) {
-      throw(ini, &before, "Section contains newline");
-      return false;
+   if (fread(buffer, 1, size, f) != (size_t)size)
+      goto error1;
+
+   fclose(f);
+   *out_buffer = buffer;
+   *out_size = size;
+   return true;
+
+error1:
+   free(buffer);
+error0:
+   fclose(f);
+   return false;
+}
+
+static bool
+resolve_path(struct chck_string *out, const char *base, const char *path, size_t len)
+{
+   assert(out && path);
+
+   // relative includes are relative to the including file
+   const char *slash;
+   if (*path == '/' || !base || !(slash = strrchr(base, '/')))
+      return chck_string_set_format(out, "%.*s", (int)len, path);
+
+   return chck_string_set_format(out, "%.*s%.*s", (int)(slash + 1 - base), base, (int)len, path);
+}
+
+static INI_PURE bool
+options_equal(const struct ini_options *a, const struct ini_options *b)
+{
+   assert(a && b);
+   return (a->escaping == b->escaping && a->quoted_strings == b->quoted_strings &&
+           a->empty_values == b->empty_values && a->empty_keys == b->empty_keys &&
+           a->includes == b->includes && a->max_keys == b->max_keys &&
+           a->max_value_length == b->max_value_length && a->max_line_length == b->max_line_length &&
+           a->max_sections == b->max_sections);
+}
+
+static void
+fragment_release(struct fragment *fragment)
+{
+   if (!fragment)
+      return;
+
+   for (size_t i = 0; i < fragment->records.items.count; ++i)
+      record_release(chck_iter_pool_get(&fragment->records, i));
+
+   chck_iter_pool_release(&fragment->records);
+   free(fragment->content);
+   memset(fragment, 0, sizeof(struct fragment));
+}
+
+static void
+cache_init(struct ini_cache *cache)
+{
+   assert(cache);
+   memset(cache, 0, sizeof(struct ini_cache));
+   chck_iter_pool(&cache->fragments, 4, 0, sizeof(struct fragment*));
+}
+
+static void
+cache_release(struct ini_cache *cache)
+{
+   assert(cache);
+
+   for (size_t i = 0; i < cache->fragments.items.count; ++i) {
+      struct fragment *f = *(struct fragment**)chck_iter_pool_get(&cache->fragments, i);
+      fragment_release(f);
+      free(f);
    }
 
-   if (has_whitespace) {
-      throw(ini, state, "Section contains whitespace");
+   chck_iter_pool_release(&cache->fragments);
+   free(cache->slots);
+   memset(cache, 0, sizeof(struct ini_cache));
+}
+
+static INI_PURE struct ini_cache*
+fragment_cache_for(struct ini *ini)
+{
+   assert(ini);
+   return (ini->cache ? ini->cache : &ini->data->cache);
+}
+
+static struct fragment*
+fragment_cache(struct ini_cache *cache, struct fragment *fragment)
+{
+   assert(cache && fragment);
+
+   // keep load at most half, fragments are few so slots are simply rebuilt
+   const size_t count = cache->fragments.items.count + 1;
+   if (count * 2 > cache->size) {
+      const size_t size = (cache->size ? cache->size * 2 : 16);
+
+      struct slot *slots;
+      if (!(slots = calloc(size, sizeof(struct slot))))
+         return NULL;
+
+      for (size_t i = 0; i < cache->fragments.items.count; ++i) {
+         const struct fragment *f = *(struct fragment**)chck_iter_pool_get(&cache->fragments, i);
+         slots_insert(slots, size, (struct slot){ f->hash, i + 1 });
+      }
+
+      free(cache->slots);
+      cache->slots = slots;
+      cache->size = size;
+   }
+
+   struct fragment *f;
+   if (!(f = malloc(sizeof(struct fragment))))
+      return NULL;
+
+   if (!chck_iter_pool_push_back(&cache->fragments, &f)) {
+      free(f);
+      return NULL;
+   }
+
+   slots_insert(cache->slots, cache->size, (struct slot){ fragment->hash, cache->fragments.items.count });
+   *f = *fragment;
+   memset(fragment, 0, sizeof(struct fragment));
+   return f;
+}
+
+static INI_PURE struct fragment*
+fragment_get(const struct ini_cache *cache, const char *content, size_t size, uint32_t hash, char delim, const struct ini_options *options)
+{
+   assert(cache && content && options);
+
+   if (!cache->size)
+      return NULL;
+
+   const size_t mask = cache->size - 1;
+   for (size_t s = hash & mask; cache->slots[s].index; s = (s + 1) & mask) {
+      if (cache->slots[s].hash != hash)
+         continue;
+
+      struct fragment *f = *(struct fragment**)chck_iter_pool_get(&cache->fragments, cache->slots[s].index - 1);
+      if (f->size == size && f->delim == delim && options_equal(&f->options, options) && !memcmp(f->content, content, size))
+         return f;
+   }
+
+   return NULL;
+}
+
+static char*
+canonical_path(const char *path)
+{
+   assert(path);
+#if defined(_WIN32)
+   return _fullpath(NULL, path, 0);
+#else
+   return realpath(path, NULL);
+#endif
+}
+
+static bool parse(struct ini *ini, struct state *state);
+
+static bool
+include(struct ini *ini, const struct state *state, const char *path, const struct chck_string *section, const struct include *includes)
+{
+   assert(ini && state && path && section);
+
+   // without cycles includes can still fan out, so total count is bounded as well as depth
+   if (++state->limits->includes > 4096) {
+      throw(ini, state, "Too many includes at '%s'", path);
+      state->limits->exceeded = true;
       return false;
    }
 
-   if (state->cursor - start > INT_MAX) {
-      throw(ini, state, "Section name too long");
+   char *id;
+   if (!(id = canonical_path(path))) {
+      throw(ini, state, "Could not read include '%s'", path);
       return false;
    }
 
-   if (state->cursor > start)
-      chck_string_set_cstr_with_length(&state->section, start, state->cursor - 1 - start, false);
+   size_t depth = 0;
+   for (const struct include *i = includes; i; i = i->parent, ++depth) {
+      if (i->path && !strcmp(i->path, id)) {
+         throw(ini, state, "Include cycle with '%s'", path);
+         goto error0;
+      }
+   }
 
-   if (chck_string_is_empty(&state->section)) {
-      throw(ini, state, "Section is empty");
-      return false;
+   if (depth > 32) {
+      throw(ini, state, "Includes nested too deep at '%s'", path);
+      goto error0;
    }
 
-   return true;
+   const size_t max_bytes = state->options.max_bytes;
+   const size_t max_size = (max_bytes ? max_bytes - (state->limits->bytes < max_bytes ? state->limits->bytes : max_bytes) : SIZE_MAX);
+
+   char *buffer;
+   size_t size;
+   if (!read_file(id, max_size, &buffer, &size)) {
+      if (size > 0) {
+         throw(ini, state, "Input exceeds limit of %zu bytes", max_bytes);
+         state->limits->exceeded = true;
+      } else {
+         throw(ini, state, "Could not read include '%s'", path);
+      }
+      goto error0;
+   }
+
+   state->limits->bytes += size;
+
+   const struct include node = { id, includes };
+   const uint32_t hash = hash_str(buffer, size);
+   struct ini_cache *cache = fragment_cache_for(ini);
+
+   bool valid = true;
+   struct fragment parsed = {0}, *fragment;
+   if ((fragment = fragment_get(cache, buffer, size, hash, ini->delim, &state->options))) {
+      free(buffer);
+   } else {
+      parsed = (struct fragment){ .options = state->options, .content = buffer, .size = size, .hash = hash, .delim = ini->delim };
+      chck_iter_pool(&parsed.records, 32, 0, sizeof(struct record));
+
+      struct state fstate;
+      memset(&fstate, 0, sizeof(fstate));
+      fstate.line = 1;
+      fstate.size = size;
+      fstate.line_start = fstate.cursor = fstate.buffer = buffer;
+      fstate.options = state->options;
+      fstate.limits = state->limits;
+      fstate.file = path;
+      fstate.includes = &node;
+      fstate.fragment = &parsed;
+      valid = (check_lines(ini, &fstate) && parse(ini, &fstate));
+
+      // only cache fragments without errors, so errors get reported for every include
+      if (!valid || !(fragment = fragment_cache(cache, &parsed)))
+         fragment = &parsed;
+   }
+
+   if (valid && state->options.max_sections && (state->limits->sections += fragment->sections) > state->options.max_sections) {
+      throw(ini, state, "Number of sections exceeds limit of %zu", state->options.max_sections);
+      state->limits->exceeded = true;
+      valid = false;
+   }
+
+   for (size_t i = 0; i < fragment->records.items.count && !past_deadline(ini, state); ++i) {
+      const struct record *r = chck_iter_pool_get(&fragment->records, i);
+
+      // errors point to the record inside the included file
+      struct state at;
+      memset(&at, 0, sizeof(at));
+      at.options = state->options;
+      at.limits = state->limits;
+      at.buffer = fragment->content;
+      at.size = fragment->size;
+      at.line = r->line;
+      at.line_start = fragment->content + r->line_start;
+      at.cursor = fragment->content + r->cursor;
+      at.file = path;
+      at.includes = &node;
+
+      const struct chck_string *rsection = (chck_string_is_empty(&r->section) ? section : &r->section);
+
+      if (r->include) {
+         struct chck_string resolved = {0};
+         if (!resolve_path(&resolved, path, r->key.data, r->key.size)) {
+            throw(ini, &at, "Could not include '%s' (out of memory?)", r->key.data);
+            valid = false;
+            continue;
+         }
+
+         if (!include(ini, &at, resolved.data, rsection, &node))
+            valid = false;
+
+         chck_string_release(&resolved);
+      } else {
+         struct chck_string value;
+         if (!copy_string(&value, &r->value)) {
+            throw(ini, &at, "Could not set key '%s' (out of memory?)", r->key.data);
+            valid = false;
+            continue;
+         }
+
+         if (!insert(ini, &at, rsection, &r->key, &value))
+            valid = false;
+      }
+   }
+
+   fragment_release(&parsed);
+   free(id);
+   return valid;
+
+error0:
+   free(id);
+   return false;
 }
 
 static bool
-parse_comment(struct ini *ini, struct state *state)
+parse_include(struct ini *ini, struct state *state)
 {
-   (void)ini;
    assert(ini && state);
-   assert(*state->cursor == '#' || *state->cursor == ';');
-   size_t line = state->line;
-   while (advance(state, true) && state->line == line) escape_eol(state, &line);
-   assert(state_end(state) || state->line != line);
-   return true;
-}
+   assert(*state->cursor == '@' || *state->cursor == '!');
 
-static char
-next(struct state *state)
-{
-   if (state_end(state))
-      return 0;
+   // anything else than "@include" or "!include" is parsed as key
+   static const char directive[] = "include";
+   const size_t avail = state->size - (state->cursor - state->buffer);
+   if (!state->options.includes || avail < sizeof(directive) || memcmp(state->cursor + 1, directive, sizeof(directive) - 1) ||
+       (avail > sizeof(directive) && !isspace((unsigned char)state->cursor[sizeof(directive)])))
+      return parse_key(ini, state);
 
-   return (!is_eol_or_space(*state->cursor) ? *state->cursor : advance(state, true));
+   struct state before = *state;
+   const char *start = NULL, *last = NULL;
+   size_t bytes = 0;
+   state->cursor += sizeof(directive) - 1;
+   while (advance(state, false) && state->line == before.line) {
+      if (sample_deadline(ini, state, &bytes))
+         return false;
+
+      // paths may be UTF-8, ctype functions take unsigned char values
+      if (isspace((unsigned char)*state->cursor))
+         continue;
+
+      start = (start ? start : state->cursor);
+      last = state->cursor;
+   }
+
+   if (!start) {
+      throw(ini, &before, "Include path is empty");
+      return false;
+   }
+
+   if (last - start >= INT_MAX) {
+      throw(ini, &before, "Include path too long");
+      return false;
+   }
+
+   // included files record the path, it gets resolved relative to wherever the fragment is grafted
+   if (state->fragment) {
+      struct chck_string key = state->key, value = {0};
+      chck_string_set_cstr_with_length(&state->key, start, last + 1 - start, false);
+      const bool ret = push_record(ini, &before, state, &value, true);
+      state->key = key;
+      return ret;
+   }
+
+   struct chck_string resolved = {0};
+   if (!resolve_path(&resolved, state->file, start, last + 1 - start)) {
+      throw(ini, &before, "Could not include '%.*s' (out of memory?)", (int)(last + 1 - start), start);
+      return false;
+   }
+
+   // top level file may be missing or unreadable again, it's fine to not know its identity then
+   char *id = (state->file && !state->includes ? canonical_path(state->file) : NULL);
+   const struct include self = { id, NULL };
+   const bool ret = include(ini, &before, resolved.data, &state->section, (state->includes ? state->includes : &self));
+   chck_string_release(&resolved);
+   free(id);
+   return ret;
 }
 
 static bool
@@ -474,12 +1830,14 @@ parse(struct ini *ini, struct state *state)
       { '[', parse_section },
       { ';', parse_comment },
       { '#', parse_comment },
+      { '@', parse_include },
+      { '!', parse_include },
       { 0, parse_key },
    };
 
    char chr;
    bool valid = true;
-   while ((chr = next(state))) {
+   while (!past_deadline(ini, state) && (chr = next(state))) {
       for (uint32_t i = 0;; ++i) {
          if (map[i].chr && map[i].chr != chr)
             continue;
@@ -491,7 +1849,20 @@ parse(struct ini *ini, struct state *state)
       }
    }
 
-   return valid;
+   return (valid && !state->limits->exceeded);
+}
+
+static INI_PURE size_t
+estimate_keys(const char *buffer, size_t size)
+{
+   assert(buffer);
+
+   // every key with value has '=', some values may contain it too but that only overestimates a bit
+   size_t count = 0;
+   for (const char *c = buffer, *end = buffer + size; (c = memchr(c, '=', end - c)); ++c) ++count;
+
+   // shortest line with key and value is "k=v\n", so values full of '=' can't inflate the estimate past that
+   return (count < size / 4 ? count : size / 4);
 }
 
 static void
@@ -500,8 +1871,9 @@ ini_data_free(struct ini_data *data)
    if (!data)
       return;
 
-   chck_hash_table_for_each_call(&data->table, chck_string_release);
-   chck_hash_table_release(&data->table);
+   cache_release(&data->cache);
+   chck_iter_pool_release(&data->pending);
+   table_release(&data->table);
    free(data);
 }
 
@@ -512,9 +1884,11 @@ ini_data(size_t size)
    if (!(data = calloc(1, sizeof(struct ini_data))))
       return NULL;
 
-   if (!chck_hash_table(&data->table, 0, size, sizeof(struct chck_string)))
+   if (!table(&data->table, size))
       goto error0;
 
+   cache_init(&data->cache);
+   chck_iter_pool(&data->pending, 32, 0, sizeof(struct pending));
    return data;
 
 error0:
@@ -525,7 +1899,7 @@ error0:
 bool
 ini(struct ini *ini, char delim, size_t size, ini_throw_cb cb)
 {
-   assert(ini && size > 0);
+   assert(ini);
    memset(ini, 0, sizeof(struct ini));
 
    if (!(ini->data = ini_data(size)))
@@ -536,6 +1910,19 @@ ini(struct ini *ini, char delim, size_t size, ini_throw_cb cb)
    return true;
 }
 
+bool
+ini_static(struct ini *ini, const struct ini_static *table)
+{
+   assert(ini && table);
+   memset(ini, 0, sizeof(struct ini));
+
+   if (!(ini->data = ini_data(0)))
+      return false;
+
+   ini->data->rodata = table;
+   return true;
+}
+
 void
 ini_release(struct ini *ini)
 {
@@ -545,29 +1932,95 @@ ini_release(struct ini *ini)
    ini_data_free(ini->data);
 }
 
+struct ini_cache*
+ini_cache(void)
+{
+   struct ini_cache *cache;
+   if (!(cache = malloc(sizeof(struct ini_cache))))
+      return NULL;
+
+   cache_init(cache);
+   return cache;
+}
+
+void
+ini_cache_release(struct ini_cache *cache)
+{
+   if (!cache)
+      return;
+
+   cache_release(cache);
+   free(cache);
+}
+
 void
 ini_flush(struct ini *ini)
 {
    assert(ini);
-   chck_hash_table_for_each_call(&ini->data->table, chck_string_release);
-   chck_hash_table_flush(&ini->data->table);
+   table_flush(&ini->data->table);
+
+   // private include cache would otherwise keep every include seen for the lifetime of struct ini
+   cache_release(&ini->data->cache);
+   cache_init(&ini->data->cache);
 }
 
-bool
-ini_parse_from_memory(struct ini *ini, const char *buffer, size_t size, const struct ini_options *options)
+static bool
+parse_buffer(struct ini *ini, const char *buffer, size_t size, const char *file, const struct ini_options *options)
 {
    assert(ini && buffer);
 
+   if (ini->data->rodata)
+      return false;
+
    struct state state;
    memset(&state, 0, sizeof(state));
    state.line = 1;
    state.size = size;
    state.line_start = state.cursor = state.buffer = buffer;
+   state.file = file;
 
    if (options)
       memcpy(&state.options, options, sizeof(state.options));
 
-   return parse(ini, &state);
+   struct limits limits = { .bytes = size };
+   state.limits = &limits;
+
+   if (state.options.max_milliseconds)
+      limits.deadline = now_ms() + state.options.max_milliseconds;
+
+   if (state.options.max_bytes && size > state.options.max_bytes) {
+      throw(ini, &state, "Input exceeds limit of %zu bytes", state.options.max_bytes);
+      return false;
+   }
+
+   if (!check_lines(ini, &state))
+      return false;
+
+   // size the table once up front, it still grows incrementally if the estimate was too low
+   size_t estimate = estimate_keys(buffer, size);
+   if (state.options.max_keys && estimate > state.options.max_keys)
+      estimate = state.options.max_keys;
+
+   if (!table_reserve(&ini->data->table, ini->data->table.count + estimate)) {
+      throw(ini, &state, "Could not reserve table for %zu keys (out of memory?)", estimate);
+      return false;
+   }
+
+   const bool valid = parse(ini, &state);
+
+   // growing during parse only spreads the rehash over inserts, lookups after parse see single slots array
+   table_migrate(&ini->data->table, SIZE_MAX);
+   const bool interpolated = interpolate(ini, &state);
+
+   // documents with few items may not have read the clock at all
+   return (interpolated && valid && !past_deadline_now(ini, &state));
+}
+
+bool
+ini_parse_from_memory(struct ini *ini, const char *buffer, size_t size, const struct ini_options *options)
+{
+   assert(ini && buffer);
+   return parse_buffer(ini, buffer, size, NULL, options);
 }
 
 bool
@@ -575,32 +2028,23 @@ ini_parse(struct ini *ini, const char *path, const struct ini_options *options)
 {
    assert(ini && path);
 
-   FILE *f;
-   if (!(f = fopen(path, "rb")))
-      return false;
-
-   fseek(f, 0, SEEK_END);
-   const size_t size = ftell(f);
-   fseek(f, 0, SEEK_SET);
-
    char *buffer;
-   if (!size || !(buffer = malloc(size)))
-      goto error0;
-
-   if (fread(buffer, 1, size, f) != size)
-      goto error1;
-
-   fclose(f);
+   size_t size;
+   const size_t max_bytes = (options ? options->max_bytes : 0);
+   if (!read_file(path, (max_bytes ? max_bytes : SIZE_MAX), &buffer, &size)) {
+      if (size > 0) {
+         struct state state;
+         memset(&state, 0, sizeof(state));
+         state.line = 1;
+         state.line_start = state.cursor = state.buffer = "";
+         throw(ini, &state, "Input exceeds limit of %zu bytes", max_bytes);
+      }
+      return false;
+   }
 
-   const bool ret = ini_parse_from_memory(ini, buffer, size, options);
+   const bool ret = (size > 0 && parse_buffer(ini, buffer, size, path, options));
    free(buffer);
    return ret;
-
-error1:
-   free(buffer);
-error0:
-   fclose(f);
-   return false;
 }
 
 bool
@@ -608,13 +2052,63 @@ ini_get(struct ini *ini, const char *path, struct ini_value *out_value)
 {
    assert(ini && path);
 
-   const struct chck_string *v = chck_hash_table_str_get(&ini->data->table, path, strlen(path));
-   if (out_value && v) {
-      out_value->data = v->data;
-      out_value->size = v->size;
+   const size_t len = strlen(path);
+   const uint32_t hash = hash_str(path, len);
+
+   if (ini->data->rodata) {
+      const struct ini_static_entry *e = static_get(ini->data->rodata, path, len, hash);
+      if (out_value && e)
+         *out_value = static_value(ini->data->rodata, e);
+
+      return (e ? true : false);
+   }
+
+   const struct entry *e = table_get(&ini->data->table, path, len, hash);
+   if (out_value && e) {
+      out_value->data = e->value.data;
+      out_value->size = e->value.size;
+   }
+
+   return (e ? true : false);
+}
+
+void
+ini_key(struct ini_key *key, const char *path)
+{
+   assert(key && path);
+   key->path = path;
+   key->size = strlen(path);
+   key->hash = hash_str(path, key->size);
+}
+
+size_t
+ini_get_keys(struct ini *ini, const struct ini_key keys[], size_t n, struct ini_value out_values[])
+{
+   assert(ini && keys && out_values);
+
+   if (ini->data->rodata)
+      return static_get_many(ini->data->rodata, keys, n, out_values);
+
+   return table_get_many(&ini->data->table, keys, n, out_values);
+}
+
+size_t
+ini_get_many(struct ini *ini, const char *const paths[], size_t n, struct ini_value out_values[])
+{
+   assert(ini && paths && out_values);
+
+   // hash in small batches, so the keys stay on stack
+   size_t found = 0;
+   for (size_t i = 0; i < n; i += 32) {
+      struct ini_key keys[32];
+      const size_t batch = (n - i < 32 ? n - i : 32);
+      for (size_t k = 0; k < batch; ++k)
+         ini_key(&keys[k], paths[i + k]);
+
+      found += ini_get_keys(ini, keys, batch, out_values + i);
    }
 
-   return (v ? true : false);
+   return found;
 }
 
 bool
@@ -623,17 +2117,26 @@ ini_iter(struct ini *ini, struct ini_iterator *iterator, struct ini_value *out_v
    assert(ini && iterator && out_value);
 
    if (!iterator->path)
-      ini->data->iterator = (struct chck_hash_table_iterator){ &ini->data->table, 0, NULL, 0 };
+      ini->data->iterator = 0;
+
+   if (ini->data->rodata) {
+      if (ini->data->iterator >= ini->data->rodata->count)
+         return false;
 
-   struct chck_string *v;
-   if ((v = chck_hash_table_iter(&ini->data->iterator))) {
-      assert(ini->data->iterator.str_key);
-      iterator->path = ini->data->iterator.str_key;
-      out_value->data = v->data;
-      out_value->size = v->size;
+      const struct ini_static_entry *e = &ini->data->rodata->entries[ini->data->iterator++];
+      iterator->path = ini->data->rodata->strings + e->path;
+      *out_value = static_value(ini->data->rodata, e);
+      return true;
    }
 
-   return (v ? true : false);
+   if (ini->data->iterator >= ini->data->table.count)
+      return false;
+
+   const struct entry *e = table_entry(&ini->data->table, ini->data->iterator++);
+   iterator->path = e->path.data;
+   out_value->data = e->value.data;
+   out_value->size = e->value.size;
+   return true;
 }
 
 void
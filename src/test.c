@@ -10,20 +10,29 @@
 #if FUZZ
 #  undef assert
 #  undef strncmp
-#  define assert(x) (void)x
+#  define assert(x) (void)(x)
 #  define strncmp(x, y, z) false
 #endif
 
+// generated from test.ini by ini2c
+extern const struct ini_static test_static;
+
+static size_t errors, error_line; // line of first error since errors was reset
+
 static void
 throw(struct ini *ini, size_t line_num, size_t position, const char *line, const char *message)
 {
    (void)ini;
+   if (!errors++)
+      error_line = line_num;
    printf("[%zu, %zu]: %s\n", line_num, position, message);
    printf("%s\n%*c\n", line, (uint32_t)position, '^');
 }
 
 int main(void)
 {
+   setenv("INIHCK_TEST", "env", 1);
+
    struct ini inif;
    assert(ini(&inif, '.', 256, NULL));
 
@@ -52,11 +61,136 @@ int main(void)
 
    ini_release(&inif);
 
-   assert(ini(&inif, '.', 256, throw));
+   assert(ini(&inif, '.', 0, throw));
 
    {
-      struct ini_options options = { .escaping = true, .quoted_strings = true, .empty_values = true, .empty_keys = true };
+      struct ini_options options = { .escaping = true, .quoted_strings = true, .empty_values = true, .empty_keys = true, .includes = true, .interpolation = true };
       assert(ini_parse(&inif, "test.ini", &options));
+      errors = 0;
+      assert(!ini_parse(&inif, "cycle.ini", &options));
+      assert(error_line == 4);
+
+      struct ini_cache *cache;
+      assert((cache = ini_cache()));
+      for (int i = 0; i < 2; ++i) {
+         struct ini shared;
+         assert(ini(&shared, '.', 0, throw));
+         shared.cache = cache;
+         assert(ini_parse(&shared, "test.ini", &options));
+         assert(ini_get(&shared, "valid[.cert", NULL));
+         ini_release(&shared);
+      }
+
+      // keys with the delimiter are invalid, so cached fragment can't be reused with other delimiter
+      const char delim[] = "[top]\n@include delim.ini\n";
+      for (int i = 0; i < 2; ++i) {
+         struct ini shared;
+         assert(ini(&shared, (i ? '/' : '.'), 0, throw));
+         shared.cache = cache;
+         assert(ini_parse_from_memory(&shared, delim, sizeof(delim) - 1, &options) == !i);
+         ini_release(&shared);
+      }
+      ini_cache_release(cache);
+
+      const char invalid[] = "[bad]\na = ${b}\nb = ${a}\nc = ${nope}\nd = ${ENV:INIHCK_NOPE}\ne = ${c}\nf = ${\n";
+      assert(!ini_parse_from_memory(&inif, invalid, sizeof(invalid) - 1, &options));
+
+      // values referencing failed values fail too, instead of copying unexpanded text
+      const char failed[] = "[failed]\nc = ${nope}\ne = ${c}\n";
+      errors = 0;
+      assert(!ini_parse_from_memory(&inif, failed, sizeof(failed) - 1, &options));
+      assert(errors == 2 && error_line == 2);
+      struct ini_value value;
+      assert(ini_get(&inif, "failed.e", &value));
+      assert(!strncmp(value.data, "${c}", value.size));
+   }
+
+   {
+      struct ini chain;
+      assert(ini(&chain, '.', 0, throw));
+
+      // long reference chains are resolved without recursion
+      const size_t count = 100000;
+      char *buffer, *c;
+      assert((buffer = c = malloc(count * 32)));
+      for (size_t i = 0; i + 1 < count; ++i) c += sprintf(c, "k%zu = ${k%zu}\n", i, i + 1);
+      c += sprintf(c, "k%zu = end\n", count - 1);
+
+      struct ini_options options = { .interpolation = true };
+      assert(ini_parse_from_memory(&chain, buffer, c - buffer, &options));
+      struct ini_value value;
+      assert(ini_get(&chain, ".k0", &value));
+      assert(!strncmp(value.data, "end", value.size));
+      free(buffer);
+      ini_release(&chain);
+   }
+
+   {
+      struct ini limited;
+      assert(ini(&limited, '.', 0, throw));
+
+      const char keys[] = "[a]\nk1 = v\nk2 = v\n[b]\nk3 = v\n";
+      struct ini_options options = { .max_keys = 3, .max_sections = 2, .max_bytes = sizeof(keys) - 1, .max_line_length = 6, .max_value_length = 2 };
+      assert(ini_parse_from_memory(&limited, keys, sizeof(keys) - 1, &options));
+      ini_flush(&limited);
+
+      options.max_keys = 2;
+      assert(!ini_parse_from_memory(&limited, keys, sizeof(keys) - 1, &options));
+      assert(!ini_get(&limited, "b.k3", NULL));
+      ini_flush(&limited);
+
+      options = (struct ini_options){ .max_sections = 1 };
+      assert(!ini_parse_from_memory(&limited, keys, sizeof(keys) - 1, &options));
+      ini_flush(&limited);
+
+      options = (struct ini_options){ .max_bytes = sizeof(keys) - 2 };
+      assert(!ini_parse_from_memory(&limited, keys, sizeof(keys) - 1, &options));
+      ini_flush(&limited);
+
+      options = (struct ini_options){ .max_line_length = 5 };
+      assert(!ini_parse_from_memory(&limited, keys, sizeof(keys) - 1, &options));
+      ini_flush(&limited);
+
+      const char laughs[] = "a = lol\nb = ${a}${a}${a}${a}\nc = ${b}${b}${b}${b}\nd = ${c}${c}${c}${c}\n";
+      options = (struct ini_options){ .interpolation = true, .max_value_length = 64 };
+      assert(!ini_parse_from_memory(&limited, laughs, sizeof(laughs) - 1, &options));
+      ini_flush(&limited);
+
+      options = (struct ini_options){ .interpolation = true, .max_bytes = sizeof(laughs) + 64 };
+      assert(!ini_parse_from_memory(&limited, laughs, sizeof(laughs) - 1, &options));
+      ini_flush(&limited);
+
+      options = (struct ini_options){ .max_value_length = 2 };
+      assert(!ini_parse_from_memory(&limited, laughs, sizeof(laughs) - 1, &options));
+      ini_flush(&limited);
+
+      // files over the limit are rejected before reading them
+      options = (struct ini_options){ .max_bytes = 16 };
+      assert(!ini_parse(&limited, "test.ini", &options));
+      ini_flush(&limited);
+
+      const char include[] = "@include include.ini\n";
+      options = (struct ini_options){ .includes = true, .max_bytes = sizeof(include) };
+      assert(!ini_parse_from_memory(&limited, include, sizeof(include) - 1, &options));
+      ini_flush(&limited);
+
+      // sections of included file count the same whether it was cached or not
+      const char sections[] = "[a]\n[b]\n[c]\n@include sections.ini\n";
+      options = (struct ini_options){ .includes = true, .max_sections = 4 };
+      assert(ini_parse_from_memory(&limited, sections + 12, sizeof(sections) - 13, &options));
+      assert(!ini_parse_from_memory(&limited, sections, sizeof(sections) - 1, &options));
+      ini_flush(&limited);
+
+      // deadline is checked inside single long value too
+      const size_t size = 16 * 1024 * 1024;
+      char *value;
+      assert((value = malloc(size)));
+      memset(value, 'x', size);
+      memcpy(value, "k = ", 4);
+      options = (struct ini_options){ .max_milliseconds = 1 };
+      assert(!ini_parse_from_memory(&limited, value, size, &options));
+      free(value);
+      ini_release(&limited);
    }
 
    struct ini_value value;
@@ -74,10 +208,72 @@ int main(void)
    assert(!strncmp(value.data, "hah", value.size));
    assert(ini_get(&inif, "valid[.valid2", &value));
    assert(!strncmp(value.data, "long string\nthat \"goes on\"", value.size));
+   assert(ini_get(&inif, "foo.tls", &value));
+   assert(!strncmp(value.data, "on", value.size));
+   assert(ini_get(&inif, "valid[.tls", &value));
+   assert(!strncmp(value.data, "on", value.size));
+   assert(ini_get(&inif, "foo.cert", &value));
+   assert(!strncmp(value.data, "/etc/ssl/cert.pem", value.size));
+   assert(ini_get(&inif, "valid[.cert", &value));
+   assert(!strncmp(value.data, "/etc/ssl/cert.pem", value.size));
+   assert(ini_get(&inif, "foo.url", &value));
+   assert(!strncmp(value.data, "https://bar:asd/env/${literal}", value.size));
+   assert(ini_get(&inif, "foo.chain", &value));
+   assert(!strncmp(value.data, "https://bar:asd/env/${literal}", value.size));
+   assert(ini_get(&inif, "cycle.key", &value));
+   assert(!strncmp(value.data, "value", value.size));
    assert(!ini_get(&inif, "foo.asd", NULL));
    assert(!ini_get(&inif, ".asd", NULL));
    assert(!ini_get(&inif, "foo.foo", NULL));
 
+   {
+      const char *paths[] = { "foo.bar2", "foo.asd", ".foo", "valid[.valid" };
+      struct ini_value values[4];
+      assert(ini_get_many(&inif, paths, 4, values) == 3);
+      assert(!strncmp(values[0].data, "asd", values[0].size));
+      assert(!values[1].data && !values[1].size);
+      assert(!strncmp(values[2].data, "bar", values[2].size));
+      assert(!strncmp(values[3].data, "hah", values[3].size));
+
+      struct ini_key keys[2];
+      ini_key(&keys[0], "foo.bar2");
+      ini_key(&keys[1], "foo.foo");
+      assert(ini_get_keys(&inif, keys, 2, values) == 1);
+      assert(!strncmp(values[0].data, "asd", values[0].size));
+      assert(!values[1].data);
+   }
+
+   {
+      struct ini rodata;
+      assert(ini_static(&rodata, &test_static));
+      assert(!ini_parse(&rodata, "test.ini", NULL));
+
+      size_t count = 0;
+      ini_for_each(&rodata, &value) {
+         struct ini_value parsed;
+         assert(ini_get(&rodata, _I.path, NULL));
+         assert(ini_get(&inif, _I.path, &parsed));
+         assert(strstr(_I.path, "url") || strstr(_I.path, "chain") || (parsed.size == value.size && (!value.size || !memcmp(parsed.data, value.data, value.size))));
+         ++count;
+      }
+      assert(count == 17);
+
+      assert(ini_get(&rodata, "foo.bar", &value));
+      assert(!strncmp(value.data, "foo UTF16: 🏩 UTF32: 🏩newline\nyeah\r\n\t\b\\0 ← null terminator", value.size));
+      assert(ini_get(&rodata, "foo.url", &value));
+      assert(!strncmp(value.data, "https://${.foo}:${bar2}/${ENV:INIHCK_TEST}/$${literal}", value.size));
+      assert(!ini_get(&rodata, "foo.asd", NULL));
+      assert(!ini_get(&rodata, "cycle.key", NULL));
+
+      const char *paths[] = { "valid[.cert", "foo.foo", ".foo" };
+      struct ini_value values[3];
+      assert(ini_get_many(&rodata, paths, 3, values) == 2);
+      assert(!strncmp(values[0].data, "/etc/ssl/cert.pem", values[0].size));
+      assert(!values[1].data);
+      assert(!strncmp(values[2].data, "bar", values[2].size));
+      ini_release(&rodata);
+   }
+
    ini_print(&inif);
    ini_release(&inif);
    return EXIT_SUCCESS;